@@ -0,0 +1,219 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include "deque.h"
+
+// Free list of equally sized raw blocks shared by every container whose
+// blocks have this size. Each thread keeps a small cache; surplus blocks
+// overflow into a global list, so blocks freed by one container are reused
+// by another. The global list is only locked when its atomic size says it
+// has blocks to hand out; otherwise a miss goes straight to new[]. Once a
+// thread's cache or the global list has been destroyed, blocks go straight
+// to new[] and delete[].
+template<size_t BlockBytes>
+class BlockPool {
+ public:
+  static uint8_t* allocate();
+  static void deallocate(uint8_t*);
+
+ private:
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+  struct GlobalList {
+    ~GlobalList();
+    std::mutex mutex;
+    FreeBlock* head = nullptr;
+    std::atomic<size_t> size{0};
+  };
+  struct LocalCache {
+    ~LocalCache();
+    FreeBlock* head = nullptr;
+    size_t size = 0;
+  };
+  static GlobalList& global();
+  static LocalCache& local();
+  static bool torn_down();
+  static void free_list(FreeBlock*);
+  static thread_local bool cache_destroyed_;
+  static std::atomic<bool> list_destroyed_;
+  static const size_t cache_limit_ = 64;
+  static const size_t batch_size_ = 32;
+  static_assert(BlockBytes >= sizeof(FreeBlock), "Block is too small to hold a free list link");
+};
+
+template<size_t BlockBytes>
+thread_local bool BlockPool<BlockBytes>::cache_destroyed_ = false;
+
+template<size_t BlockBytes>
+std::atomic<bool> BlockPool<BlockBytes>::list_destroyed_(false);
+
+template<size_t BlockBytes>
+uint8_t* BlockPool<BlockBytes>::allocate() {
+  if (torn_down()) {
+    return new uint8_t[BlockBytes];
+  }
+  LocalCache& cache = local();
+  if (cache.head == nullptr) {
+    GlobalList& list = global();
+    if (list.size.load(std::memory_order_relaxed) == 0) {
+      return new uint8_t[BlockBytes];
+    }
+    std::lock_guard<std::mutex> lock(list.mutex);
+    while (list.head != nullptr && cache.size < batch_size_) {
+      FreeBlock* block = list.head;
+      list.head = block->next;
+      block->next = cache.head;
+      cache.head = block;
+      ++cache.size;
+    }
+    list.size.fetch_sub(cache.size, std::memory_order_relaxed);
+  }
+  if (cache.head == nullptr) {
+    return new uint8_t[BlockBytes];
+  }
+  FreeBlock* block = cache.head;
+  cache.head = block->next;
+  --cache.size;
+  return reinterpret_cast<uint8_t*>(block);
+}
+
+template<size_t BlockBytes>
+void BlockPool<BlockBytes>::deallocate(uint8_t* data) {
+  if (torn_down()) {
+    delete[] data;
+    return;
+  }
+  LocalCache& cache = local();
+  cache.head = new(data) FreeBlock{cache.head};
+  ++cache.size;
+  if (cache.size > cache_limit_) {
+    GlobalList& list = global();
+    std::lock_guard<std::mutex> lock(list.mutex);
+    while (cache.size > cache_limit_ - batch_size_) {
+      FreeBlock* block = cache.head;
+      cache.head = block->next;
+      block->next = list.head;
+      list.head = block;
+      --cache.size;
+      list.size.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+}
+
+template<size_t BlockBytes>
+BlockPool<BlockBytes>::GlobalList::~GlobalList() {
+  std::lock_guard<std::mutex> lock(mutex);
+  list_destroyed_.store(true);
+  free_list(head);
+  head = nullptr;
+  size.store(0, std::memory_order_relaxed);
+}
+
+template<size_t BlockBytes>
+BlockPool<BlockBytes>::LocalCache::~LocalCache() {
+  cache_destroyed_ = true;
+  FreeBlock* blocks = head;
+  head = nullptr;
+  size = 0;
+  if (blocks == nullptr) {
+    return;
+  }
+  if (list_destroyed_.load()) {
+    free_list(blocks);
+    return;
+  }
+  FreeBlock* tail = blocks;
+  size_t count = 1;
+  while (tail->next != nullptr) {
+    tail = tail->next;
+    ++count;
+  }
+  GlobalList& list = global();
+  std::lock_guard<std::mutex> lock(list.mutex);
+  tail->next = list.head;
+  list.head = blocks;
+  list.size.fetch_add(count, std::memory_order_relaxed);
+}
+
+template<size_t BlockBytes>
+typename BlockPool<BlockBytes>::GlobalList& BlockPool<BlockBytes>::global() {
+  static GlobalList list;
+  return list;
+}
+
+template<size_t BlockBytes>
+typename BlockPool<BlockBytes>::LocalCache& BlockPool<BlockBytes>::local() {
+  static thread_local LocalCache cache;
+  return cache;
+}
+
+template<size_t BlockBytes>
+bool BlockPool<BlockBytes>::torn_down() {
+  return cache_destroyed_ || list_destroyed_.load();
+}
+
+template<size_t BlockBytes>
+void BlockPool<BlockBytes>::free_list(FreeBlock* head) {
+  while (head != nullptr) {
+    FreeBlock* block = head;
+    head = block->next;
+    delete[] reinterpret_cast<uint8_t*>(block);
+  }
+}
+
+// Allocator that serves requests of exactly BlockSize elements from
+// BlockPool and everything else from std::allocator. The default BlockSize
+// follows Deque, so its element blocks always come from the pool.
+template<typename T, size_t BlockSize = Deque<T>::block_size>
+class BlockPoolAllocator {
+ private:
+  using pool = BlockPool<BlockSize * sizeof(T)>;
+
+ public:
+  using value_type = T;
+  using pointer = T*;
+  using reference = T&;
+  using const_pointer = const T*;
+  using const_reference = const T&;
+
+  template <typename U>
+  struct rebind {
+    using other = BlockPoolAllocator<U, BlockSize>;
+  };
+
+  BlockPoolAllocator() = default;
+
+  template<typename U>
+  BlockPoolAllocator(const BlockPoolAllocator<U, BlockSize>&) {}
+
+  pointer allocate(size_t n) {
+    static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "BlockPool blocks are not aligned for this type");
+    if (n == BlockSize) {
+      return reinterpret_cast<T*>(pool::allocate());
+    }
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T* data, size_t n) {
+    if (n == BlockSize) {
+      pool::deallocate(reinterpret_cast<uint8_t*>(data));
+      return;
+    }
+    std::allocator<T>().deallocate(data, n);
+  }
+
+  template <typename U>
+  bool operator==(const BlockPoolAllocator<U, BlockSize>&) const {
+    return true;
+  }
+
+  template<typename U>
+  bool operator!=(const BlockPoolAllocator<U, BlockSize>& alloc) const {
+    return !(*this == alloc);
+  }
+};
@@ -1,11 +1,23 @@
-template<typename T>
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+template<typename T, typename alloc_type = std::allocator<T> >
 class Deque{
  public:
+  static const size_t block_size = 32;
   Deque();
-  Deque(const Deque<T>&);
+  Deque(const Deque<T, alloc_type>&);
   explicit Deque(const size_t);
   Deque(const size_t, const T&);
-  Deque<T>& operator=(const Deque<T>&);
+  Deque<T, alloc_type>& operator=(const Deque<T, alloc_type>&);
   ~Deque();
   size_t size() const;
   T& operator[](const size_t);
@@ -38,127 +50,235 @@ class Deque{
   void erase(iterator);
 
  private:
-  void copy(const Deque<T>&);
+  void copy(const Deque<T, alloc_type>&);
   void set();
-  void swap(Deque<T>&);
   void expand();
   void clear();
-  static const size_t block_size_ = 32;
+  void release();
+  T* inline_block();
+  T* allocate_block();
+  void deallocate_block(T*);
+  static const size_t block_size_ = block_size;
   static const size_t expansion_coefficient_ = 3;
+  static const size_t inline_map_size_ = expansion_coefficient_;
+  static const size_t max_inline_bytes_ = 512;
+  static const bool has_inline_block_ = block_size_ * sizeof(T) <= max_inline_bytes_;
   size_t first_index_;
   size_t number_of_blocks_;
   size_t size_;
   T** data_;
+  using alloc_traits = std::allocator_traits<alloc_type>;
+  alloc_type allocator_;
+  // The first block and a small map live inside the object, so a deque
+  // that stays within one block never touches the heap. The block is kept
+  // inline only up to max_inline_bytes_, so Deques of large types do not
+  // become large objects themselves.
+  T* inline_map_[inline_map_size_];
+  alignas(T) uint8_t inline_block_[has_inline_block_ ? block_size_ * sizeof(T) : 1];
 };
 
 // Iterators
 
-template <typename T>
+template <typename T, typename alloc_type>
 template <bool is_const>
-class Deque<T>::common_iterator {
+class Deque<T, alloc_type>::common_iterator {
  public:
   using difference_type = std::ptrdiff_t;
   using value_type = typename std::conditional<is_const, const T, T>::type;
   using pointer = typename std::conditional<is_const, const T*, T*>::type;
   using reference = typename std::conditional<is_const, const T&, T&>::type;
   using iterator_category = std::random_access_iterator_tag;
-  using deque_type = typename std::conditional<is_const, T** const, T**>::type;
 
-  common_iterator(deque_type deque, size_t index): deque_(deque), index_(index) {
+  common_iterator(): cur_(nullptr), first_(nullptr), last_(nullptr), node_(nullptr) {
+  }
+  common_iterator(T** data, size_t index) {
+    set_node(data + index / block_size_);
+    cur_ = first_ + index % block_size_;
   }
   reference operator*() const {
-    return deque_[index_ / block_size_][index_ % block_size_];
+    return *cur_;
   }
   pointer operator->() const {
-    return deque_[index_ / block_size_] + index_ % block_size_;
+    return cur_;
+  }
+  reference operator[](difference_type i) const {
+    return *(*this + i);
   }
   common_iterator<is_const>& operator++() {
-    ++index_;
+    ++cur_;
+    if (cur_ == last_) {
+      set_node(node_ + 1);
+      cur_ = first_;
+    }
     return *this;
   }
   common_iterator<is_const>& operator--() {
-    --index_;
+    if (cur_ == first_) {
+      set_node(node_ - 1);
+      cur_ = last_;
+    }
+    --cur_;
     return *this;
   }
-  common_iterator<is_const>& operator++(int) {
+  common_iterator<is_const> operator++(int) {
     common_iterator<is_const> iter = *this;
     ++*this;
     return iter;
   }
-  common_iterator<is_const>& operator--(int) {
+  common_iterator<is_const> operator--(int) {
     common_iterator<is_const> iter = *this;
     --*this;
     return iter;
   }
-  common_iterator<is_const>& operator+=(int i) {
-    index_ += i;
+  common_iterator<is_const>& operator+=(difference_type i) {
+    const difference_type block = static_cast<difference_type>(block_size_);
+    const difference_type offset = i + (cur_ - first_);
+    if (offset >= 0 && offset < block) {
+      cur_ += i;
+    } else {
+      const difference_type node_offset = offset > 0 ? offset / block : -((-offset - 1) / block) - 1;
+      set_node(node_ + node_offset);
+      cur_ = first_ + (offset - node_offset * block);
+    }
     return *this;
   }
-  common_iterator<is_const>& operator-=(int i) {
-    index_ -= i;
-    return *this;
+  common_iterator<is_const>& operator-=(difference_type i) {
+    return *this += -i;
   }
-  common_iterator<is_const> operator+(int i) {
+  common_iterator<is_const> operator+(difference_type i) const {
     common_iterator<is_const> iter = *this;
     iter += i;
     return iter;
   }
-  common_iterator<is_const> operator-(int i) {
+  common_iterator<is_const> operator-(difference_type i) const {
     common_iterator<is_const> iter = *this;
     iter -= i;
     return iter;
   }
-  bool operator<(const typename Deque<T>::template common_iterator<is_const> iter) const {
-    return index_ < iter.index_;
+  // Comparisons accept either constness, so iterator and const_iterator
+  // can be mixed on both sides.
+  template<bool other_const>
+  bool operator<(const common_iterator<other_const>& iter) const {
+    return node_ == iter.node_ ? cur_ < iter.cur_ : node_ < iter.node_;
   }
-  bool operator>(const typename Deque<T>::template common_iterator<is_const> iter) const {
-    return index_ > iter.index_;
+  template<bool other_const>
+  bool operator>(const common_iterator<other_const>& iter) const {
+    return iter < *this;
   }
-  bool operator<=(const typename Deque<T>::template common_iterator<is_const> iter) const {
-    return index_ <= iter.index_;
+  template<bool other_const>
+  bool operator<=(const common_iterator<other_const>& iter) const {
+    return !(iter < *this);
   }
-  bool operator>=(const typename Deque<T>::template common_iterator<is_const> iter) const {
-    return index_ >= iter.index_;
+  template<bool other_const>
+  bool operator>=(const common_iterator<other_const>& iter) const {
+    return !(*this < iter);
   }
-  bool operator==(const typename Deque<T>::template common_iterator<is_const> iter) const {
-    return index_ == iter.index_;
+  template<bool other_const>
+  bool operator==(const common_iterator<other_const>& iter) const {
+    return cur_ == iter.cur_;
   }
-  bool operator!=(const typename Deque<T>::template common_iterator<is_const> iter) const {
-    return index_ != iter.index_;
+  template<bool other_const>
+  bool operator!=(const common_iterator<other_const>& iter) const {
+    return cur_ != iter.cur_;
   }
-  int operator-(const typename Deque<T>::template common_iterator<is_const> iter) const {
-    return index_ - iter.index_;
+  template<bool other_const>
+  difference_type operator-(const common_iterator<other_const>& iter) const {
+    return static_cast<difference_type>(block_size_) * (node_ - iter.node_ - 1) + (cur_ - first_) + (iter.last_ - iter.cur_);
   }
-  size_t get_index() {
-    return index_;
+  friend common_iterator<is_const> operator+(difference_type i, const common_iterator<is_const>& iter) {
+    return iter + i;
   }
+  operator common_iterator<true>() const {
+    return common_iterator<true>(node_, cur_);
+  }
+
+  friend common_iterator<!is_const>;
  private:
-  T** deque_;
-  size_t index_;
-  static const size_t block_size_ = 32;
+  // Current element and the bounds of its block are cached, so moving
+  // inside a block is a pointer bump and the map is touched once per block.
+  common_iterator(T** node, pointer cur): cur_(cur) {
+    set_node(node);
+  }
+  void set_node(T** node) {
+    node_ = node;
+    first_ = *node;
+    last_ = first_ + block_size_;
+  }
+  pointer cur_;
+  pointer first_;
+  pointer last_;
+  T** node_;
+  static const size_t block_size_ = Deque<T, alloc_type>::block_size;
 };
 
 // Constructors, destructor, assigning
 
-template<typename T>
-Deque<T>::Deque(): first_index_(0), number_of_blocks_(1), size_(0) {
+template<typename T, typename alloc_type>
+Deque<T, alloc_type>::Deque(): first_index_(block_size_ / 2), number_of_blocks_(1), size_(0) {
   set();
 }
 
-template<typename T>
-Deque<T>::Deque(const Deque<T>& deque) {
+template<typename T, typename alloc_type>
+Deque<T, alloc_type>::Deque(const Deque<T, alloc_type>& deque):
+    allocator_(alloc_traits::select_on_container_copy_construction(deque.allocator_)) {
   copy(deque);
 }
 
-template<typename T>
-Deque<T>& Deque<T>::operator=(const Deque<T>& deque) {
-  Deque<T> other(deque);
-  swap(other);
+template<typename T, typename alloc_type>
+Deque<T, alloc_type>& Deque<T, alloc_type>::operator=(const Deque<T, alloc_type>& deque) {
+  if (this == &deque) {
+    return *this;
+  }
+  // A single-block source is copied into a temporary in its own inline
+  // storage and then moved into ours, which cannot throw.
+  if (has_inline_block_ && deque.number_of_blocks_ == 1 && std::is_nothrow_move_constructible<T>::value) {
+    Deque<T, alloc_type> other(deque);
+    clear();
+    if (alloc_traits::propagate_on_container_copy_assignment::value) {
+      allocator_ = deque.allocator_;
+    }
+    first_index_ = other.first_index_;
+    for (size_t i = first_index_; i < first_index_ + other.size_; ++i) {
+      new(inline_block() + i) T(std::move(other.data_[0][i]));
+      ++size_;
+    }
+    return *this;
+  }
+  // Larger sources are copied into fresh blocks, so *this is only released
+  // once the copy has succeeded and keeps its contents if a copy throws.
+  alloc_type allocator = alloc_traits::propagate_on_container_copy_assignment::value ? deque.allocator_ : allocator_;
+  T** new_data = new T*[deque.number_of_blocks_];
+  size_t allocated = 0;
+  size_t i = deque.first_index_;
+  try {
+    for (; allocated < deque.number_of_blocks_; ++allocated) {
+      new_data[allocated] = alloc_traits::allocate(allocator, block_size_);
+    }
+    for (; i < deque.first_index_ + deque.size_; ++i) {
+      new(new_data[i / block_size_] + i % block_size_) T(deque.data_[i / block_size_][i % block_size_]);
+    }
+  } catch (...) {
+    while (i > deque.first_index_) {
+      --i;
+      (new_data[i / block_size_] + i % block_size_)->~T();
+    }
+    while (allocated > 0) {
+      alloc_traits::deallocate(allocator, new_data[--allocated], block_size_);
+    }
+    delete[] new_data;
+    throw;
+  }
+  release();
+  allocator_ = allocator;
+  data_ = new_data;
+  first_index_ = deque.first_index_;
+  number_of_blocks_ = deque.number_of_blocks_;
+  size_ = deque.size_;
   return *this;
 }
 
-template<typename T>
-Deque<T>::Deque(const size_t size): first_index_(0), number_of_blocks_(size / block_size_ + 1), size_(0) {
+template<typename T, typename alloc_type>
+Deque<T, alloc_type>::Deque(const size_t size): first_index_(0), number_of_blocks_(size / block_size_ + 1), size_(0) {
   set();
   for (size_t i = 0; i < size; ++i) {
     try {
@@ -170,8 +290,8 @@ Deque<T>::Deque(const size_t size): first_index_(0), number_of_blocks_(size / bl
   }
 }
 
-template<typename T>
-Deque<T>::Deque(const size_t size, const T& value): first_index_(0), number_of_blocks_(size / block_size_ + 1), size_(0) {
+template<typename T, typename alloc_type>
+Deque<T, alloc_type>::Deque(const size_t size, const T& value): first_index_(0), number_of_blocks_(size / block_size_ + 1), size_(0) {
   set();
   for (size_t i = 0; i < size; ++i) {
     try {
@@ -183,38 +303,38 @@ Deque<T>::Deque(const size_t size, const T& value): first_index_(0), number_of_b
   }
 }
 
-template <typename T>
-Deque<T>::~Deque() {
-  clear();
+template <typename T, typename alloc_type>
+Deque<T, alloc_type>::~Deque() {
+  release();
 }
 
-template<typename T>
-size_t Deque<T>::size() const {
+template<typename T, typename alloc_type>
+size_t Deque<T, alloc_type>::size() const {
   return size_;
 }
 
 // Element access
 
-template<typename T>
-T& Deque<T>::operator[](const size_t index) {
+template<typename T, typename alloc_type>
+T& Deque<T, alloc_type>::operator[](const size_t index) {
   return data_[(first_index_ + index) / block_size_][(first_index_ + index) % block_size_];
 }
 
-template<typename T>
-const T& Deque<T>::operator[](const size_t index) const {
+template<typename T, typename alloc_type>
+const T& Deque<T, alloc_type>::operator[](const size_t index) const {
   return data_[(first_index_ + index) / block_size_][(first_index_ + index) % block_size_];
 }
 
-template<typename T>
-T& Deque<T>::at(const size_t index) {
+template<typename T, typename alloc_type>
+T& Deque<T, alloc_type>::at(const size_t index) {
   if (index >= size_) {
     throw(std::out_of_range("Requested index out of range"));
   }
   return data_[(first_index_ + index) / block_size_][(first_index_ + index) % block_size_];
 }
 
-template<typename T>
-const T& Deque<T>::at(const size_t index) const {
+template<typename T, typename alloc_type>
+const T& Deque<T, alloc_type>::at(const size_t index) const {
   if (index >= size_) {
     throw(std::out_of_range("Requested index out of range"));
   }
@@ -223,9 +343,9 @@ const T& Deque<T>::at(const size_t index) const {
 
 // Push, pop
 
-template<typename T>
-void Deque<T>::push_back(const T& value) {
-  if (first_index_ + size_ == block_size_ * number_of_blocks_) {
+template<typename T, typename alloc_type>
+void Deque<T, alloc_type>::push_back(const T& value) {
+  if (first_index_ + size_ + 1 == block_size_ * number_of_blocks_) {
     expand();
   }
   try {
@@ -237,8 +357,8 @@ void Deque<T>::push_back(const T& value) {
   }
 }
 
-template<typename T>
-void Deque<T>::push_front(const T& value) {
+template<typename T, typename alloc_type>
+void Deque<T, alloc_type>::push_front(const T& value) {
   if (first_index_ == 0) {
     expand();
   }
@@ -252,14 +372,14 @@ void Deque<T>::push_front(const T& value) {
   }
 }
 
-template<typename T>
-void Deque<T>::pop_back() {
+template<typename T, typename alloc_type>
+void Deque<T, alloc_type>::pop_back() {
   (data_[(first_index_ + size_ - 1) / block_size_] + (first_index_ + size_ - 1) % block_size_)->~T();
   --size_;
 }
 
-template<typename T>
-void Deque<T>::pop_front() {
+template<typename T, typename alloc_type>
+void Deque<T, alloc_type>::pop_front() {
   (data_[first_index_ / block_size_] + first_index_ % block_size_)->~T();
   --size_;
   ++first_index_;
@@ -267,83 +387,85 @@ void Deque<T>::pop_front() {
 
 // Begins and ends
 
-template<typename T>
-typename Deque<T>::iterator Deque<T>::begin() {
+template<typename T, typename alloc_type>
+typename Deque<T, alloc_type>::iterator Deque<T, alloc_type>::begin() {
   return Deque::iterator(data_, first_index_);
 }
 
-template<typename T>
-typename Deque<T>::const_iterator Deque<T>::begin() const {
+template<typename T, typename alloc_type>
+typename Deque<T, alloc_type>::const_iterator Deque<T, alloc_type>::begin() const {
   return Deque::const_iterator(data_, first_index_);
 }
 
-template<typename T>
-typename Deque<T>::const_iterator Deque<T>::cbegin() const {
+template<typename T, typename alloc_type>
+typename Deque<T, alloc_type>::const_iterator Deque<T, alloc_type>::cbegin() const {
   return Deque::const_iterator(data_, first_index_);
 }
 
-template<typename T>
-typename Deque<T>::iterator Deque<T>::end() {
+template<typename T, typename alloc_type>
+typename Deque<T, alloc_type>::iterator Deque<T, alloc_type>::end() {
   return Deque::iterator(data_, first_index_ + size());
 }
 
-template<typename T>
-typename Deque<T>::const_iterator Deque<T>::end() const {
+template<typename T, typename alloc_type>
+typename Deque<T, alloc_type>::const_iterator Deque<T, alloc_type>::end() const {
   return Deque::const_iterator(data_, first_index_ + size());
 }
 
-template<typename T>
-typename Deque<T>::const_iterator Deque<T>::cend() const {
+template<typename T, typename alloc_type>
+typename Deque<T, alloc_type>::const_iterator Deque<T, alloc_type>::cend() const {
   return Deque::const_iterator(data_, first_index_ + size());
 }
 
-template<typename T>
-typename Deque<T>::reverse_iterator Deque<T>::rbegin() {
+template<typename T, typename alloc_type>
+typename Deque<T, alloc_type>::reverse_iterator Deque<T, alloc_type>::rbegin() {
   return std::make_reverse_iterator(end());
 }
 
-template<typename T>
-typename Deque<T>::const_reverse_iterator Deque<T>::rbegin() const {
+template<typename T, typename alloc_type>
+typename Deque<T, alloc_type>::const_reverse_iterator Deque<T, alloc_type>::rbegin() const {
   return std::make_reverse_iterator(cend());
 }
 
-template<typename T>
-typename Deque<T>::const_reverse_iterator Deque<T>::crbegin() const {
+template<typename T, typename alloc_type>
+typename Deque<T, alloc_type>::const_reverse_iterator Deque<T, alloc_type>::crbegin() const {
   return std::make_reverse_iterator(cend());
 }
 
-template<typename T>
-typename Deque<T>::reverse_iterator Deque<T>::rend() {
+template<typename T, typename alloc_type>
+typename Deque<T, alloc_type>::reverse_iterator Deque<T, alloc_type>::rend() {
   return std::make_reverse_iterator(begin());
 }
 
-template<typename T>
-typename Deque<T>::const_reverse_iterator Deque<T>::rend() const {
+template<typename T, typename alloc_type>
+typename Deque<T, alloc_type>::const_reverse_iterator Deque<T, alloc_type>::rend() const {
   return std::make_reverse_iterator(cbegin());
 }
 
-template<typename T>
-typename Deque<T>::const_reverse_iterator Deque<T>::crend() const {
+template<typename T, typename alloc_type>
+typename Deque<T, alloc_type>::const_reverse_iterator Deque<T, alloc_type>::crend() const {
   return std::make_reverse_iterator(cbegin());
 }
 
 // Insert and erase
 
-template<typename T>
-void Deque<T>::insert(Deque<T>::iterator iter, const T& value) {
-  if (first_index_ + size_ == block_size_ * number_of_blocks_) {
+template<typename T, typename alloc_type>
+void Deque<T, alloc_type>::insert(Deque<T, alloc_type>::iterator iter, const T& value) {
+  size_t position = iter - begin();
+  if (first_index_ + size_ + 1 == block_size_ * number_of_blocks_) {
     expand();
   }
-  for (size_t i = first_index_ + size_; i > iter.get_index(); --i) {
+  position += first_index_;
+  for (size_t i = first_index_ + size_; i > position; --i) {
     data_[i / block_size_][i % block_size_] = data_[(i - 1) / block_size_][(i - 1) % block_size_];
   }
-  data_[iter.get_index() / block_size_][iter.get_index() % block_size_] = value;
+  data_[position / block_size_][position % block_size_] = value;
   ++size_;
 }
 
-template<typename T>
-void Deque<T>::erase(Deque<T>::iterator iter) {
-  for (size_t i = iter.get_index(); i < first_index_ + size_ - 1; ++i) {
+template<typename T, typename alloc_type>
+void Deque<T, alloc_type>::erase(Deque<T, alloc_type>::iterator iter) {
+  for (size_t i = first_index_ + (iter - begin()); i < first_index_ + size_ - 1; ++i) {
     data_[i / block_size_][i % block_size_] = data_[(i + 1) / block_size_][(i + 1) % block_size_];
   }
   pop_back();
@@ -351,60 +473,126 @@ void Deque<T>::erase(Deque<T>::iterator iter) {
 
 // Helper functions
 
-template<typename T>
-void Deque<T>::set() {
-  data_ = new T*[number_of_blocks_];
-  for (size_t i = 0; i < number_of_blocks_; ++i) {
-    data_[i] = reinterpret_cast<T*>(new uint8_t[block_size_ * sizeof(T)]);
+template<typename T, typename alloc_type>
+void Deque<T, alloc_type>::set() {
+  data_ = number_of_blocks_ <= inline_map_size_ ? inline_map_ : new T*[number_of_blocks_];
+  size_t allocated = 0;
+  if (has_inline_block_) {
+    data_[allocated++] = inline_block();
+  }
+  try {
+    for (; allocated < number_of_blocks_; ++allocated) {
+      data_[allocated] = allocate_block();
+    }
+  } catch (...) {
+    while (allocated > 0) {
+      --allocated;
+      if (data_[allocated] != inline_block()) {
+        deallocate_block(data_[allocated]);
+      }
+    }
+    if (data_ != inline_map_) {
+      delete[] data_;
+    }
+    throw;
   }
 }
 
-template<typename T>
-void Deque<T>::expand() {
+template<typename T, typename alloc_type>
+void Deque<T, alloc_type>::expand() {
   size_t new_number_of_blocks = expansion_coefficient_ * number_of_blocks_;
-  T** new_data = new T*[new_number_of_blocks];
-  size_t j = number_of_blocks_;
-  for (size_t i = 0; i < new_number_of_blocks; ++i) {
-    new_data[i] = reinterpret_cast<T*>(new uint8_t[block_size_ * sizeof(T)]);
+  size_t new_blocks = new_number_of_blocks - number_of_blocks_;
+  T** new_data = new_number_of_blocks <= inline_map_size_ ? inline_map_ : new T*[new_number_of_blocks];
+  // New blocks are allocated before the map is touched, since the inline
+  // map may be both the old and the new one.
+  T* inline_fresh[inline_map_size_];
+  T** fresh = new_data == inline_map_ ? inline_fresh : new_data;
+  size_t allocated = 0;
+  try {
+    for (; allocated < new_blocks; ++allocated) {
+      fresh[allocated] = allocate_block();
+    }
+  } catch (...) {
+    while (allocated > 0) {
+      deallocate_block(fresh[--allocated]);
+    }
+    if (new_data != inline_map_) {
+      delete[] new_data;
+    }
+    throw;
+  }
+  // Fresh blocks go to both ends and the old ones to the middle.
+  for (size_t i = number_of_blocks_; i < new_blocks; ++i) {
+    new_data[number_of_blocks_ + i] = fresh[i];
+  }
+  for (size_t i = number_of_blocks_; i > 0; --i) {
+    new_data[number_of_blocks_ + i - 1] = data_[i - 1];
   }
   for (size_t i = 0; i < number_of_blocks_; ++i) {
-    new_data[j + i] = data_[i];
+    new_data[i] = fresh[i];
+  }
+  if (data_ != inline_map_) {
+    delete[] data_;
   }
-  delete[] data_;
   data_ = new_data;
   first_index_ += block_size_ * number_of_blocks_;
   number_of_blocks_ = new_number_of_blocks;
 }
 
-template<typename T>
-void Deque<T>::swap(Deque<T>& deque) {
-  std::swap(first_index_, deque.first_index_);
-  std::swap(number_of_blocks_, deque.number_of_blocks_);
-  std::swap(size_, deque.size_);
-  std::swap(data_, deque.data_);
-}
-
-template<typename T>
-void Deque<T>::copy(const Deque<T>& deque) {
+template<typename T, typename alloc_type>
+void Deque<T, alloc_type>::copy(const Deque<T, alloc_type>& deque) {
   first_index_ = deque.first_index_;
   number_of_blocks_ = deque.number_of_blocks_;
-  size_ = deque.size_;
-  data_ = new T*[number_of_blocks_];
-  for (size_t i = 0; i < number_of_blocks_; ++i) {
-    data_[i] = reinterpret_cast<T*>(new uint8_t[block_size_ * sizeof(T)]);
-  }
-  for (size_t i = first_index_; i < first_index_ + size_; ++i) {
-    data_[i / block_size_][i % block_size_] = deque.data_[i / block_size_][i % block_size_];
+  size_ = 0;
+  set();
+  try {
+    for (size_t i = first_index_; i < first_index_ + deque.size_; ++i) {
+      new(data_[i / block_size_] + i % block_size_) T(deque.data_[i / block_size_][i % block_size_]);
+      ++size_;
+    }
+  } catch (...) {
+    release();
+    throw;
   }
 }
 
-template<typename T>
-void Deque<T>::clear() {
+// Leaves an empty deque that uses only the inline storage.
+template<typename T, typename alloc_type>
+void Deque<T, alloc_type>::clear() {
+  release();
+  first_index_ = block_size_ / 2;
+  number_of_blocks_ = 1;
+  size_ = 0;
+  set();
+}
+
+// Destroys the elements and frees the blocks and map, leaving data_ dangling.
+template<typename T, typename alloc_type>
+void Deque<T, alloc_type>::release() {
   for (size_t i = first_index_; i < first_index_ + size_; ++i) {
     (data_[i / block_size_] + i % block_size_)->~T();
   }
   for (size_t i = 0; i < number_of_blocks_; ++i) {
-    delete[] reinterpret_cast<uint8_t*>(data_[i]);
+    if (data_[i] != inline_block()) {
+      deallocate_block(data_[i]);
+    }
   }
-  delete[] data_;
+  if (data_ != inline_map_) {
+    delete[] data_;
+  }
+}
+
+template<typename T, typename alloc_type>
+T* Deque<T, alloc_type>::inline_block() {
+  return has_inline_block_ ? reinterpret_cast<T*>(inline_block_) : nullptr;
+}
+
+template<typename T, typename alloc_type>
+T* Deque<T, alloc_type>::allocate_block() {
+  return alloc_traits::allocate(allocator_, block_size_);
+}
+
+template<typename T, typename alloc_type>
+void Deque<T, alloc_type>::deallocate_block(T* block) {
+  alloc_traits::deallocate(allocator_, block, block_size_);
 }
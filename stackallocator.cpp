@@ -1,28 +1,100 @@
 #include <iostream>
 #include <cstddef>
+#include <cstdint>
+#include <new>
+#include <sys/mman.h>
 
-template<size_t N>
-class StackStorage {
+// Bump allocator over a contiguous buffer. Alignment is applied to the
+// address itself, so it holds for any requested align.
+class ArenaStorage {
  private:
-  char data_[N];
+  char* begin_;
+  size_t capacity_;
   size_t align_ = 0;
+ protected:
+  ArenaStorage(char* begin, size_t capacity): begin_(begin), capacity_(capacity) {}
+
+  char* begin() const {
+    return begin_;
+  }
  public:
-  StackStorage() = default;
+  static const size_t cache_line_size_ = 64;
+
+  ArenaStorage(const ArenaStorage&) = delete;
+  ArenaStorage& operator=(const ArenaStorage&) = delete;
 
   void* allocate(size_t n, size_t align) {
-    if (align_ % align != 0) {
-      align_ += align - align_ % align;
+    uintptr_t address = reinterpret_cast<uintptr_t>(begin_) + align_;
+    size_t offset = align_ + (align - address % align) % align;
+    if (offset > capacity_ || n > capacity_ - offset) {
+      throw std::bad_alloc();
     }
-    char* block = data_ + align_;
-    align_ += n;
-    return block;
+    align_ = offset + n;
+    return begin_ + offset;
+  }
+};
+
+template<size_t N, size_t Align = ArenaStorage::cache_line_size_>
+class StackStorage: public ArenaStorage {
+ private:
+  static_assert(Align >= cache_line_size_ && (Align & (Align - 1)) == 0,
+                "Align must be a power of two no smaller than a cache line");
+  alignas(Align) char data_[N];
+ public:
+  StackStorage(): ArenaStorage(data_, N) {}
+};
+
+// Large arena in anonymous memory advised for transparent huge pages.
+// With prefault every page is touched up front, so the first allocations
+// do not pay for page faults.
+template<size_t N>
+class HugePageStorage: public ArenaStorage {
+ private:
+  static const size_t huge_page_size_ = 2 * 1024 * 1024;
+  static const size_t page_size_ = 4096;
+  static const size_t mapped_size_ = (N + huge_page_size_ - 1) / huge_page_size_ * huge_page_size_;
+
+  // mmap only guarantees page alignment, and huge pages need a 2 MiB
+  // aligned range, so map an extra huge page and trim both ends.
+  static char* map() {
+    void* data = mmap(nullptr, mapped_size_ + huge_page_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+    char* raw = static_cast<char*>(data);
+    uintptr_t address = reinterpret_cast<uintptr_t>(raw);
+    char* aligned = raw + (huge_page_size_ - address % huge_page_size_) % huge_page_size_;
+    if (aligned != raw) {
+      munmap(raw, aligned - raw);
+    }
+    size_t tail = raw + mapped_size_ + huge_page_size_ - (aligned + mapped_size_);
+    if (tail != 0) {
+      munmap(aligned + mapped_size_, tail);
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, mapped_size_, MADV_HUGEPAGE);
+#endif
+    return aligned;
+  }
+ public:
+  explicit HugePageStorage(bool prefault = false): ArenaStorage(map(), N) {
+    if (prefault) {
+      volatile char* data = begin();
+      for (size_t i = 0; i < mapped_size_; i += page_size_) {
+        data[i] = 0;
+      }
+    }
+  }
+
+  ~HugePageStorage() {
+    munmap(begin(), mapped_size_);
   }
 };
 
 template<typename T, size_t N>
 class StackAllocator {
  private:
-  StackStorage<N>* storage_;
+  ArenaStorage* storage_;
 
  public:
   using value_type = T;
@@ -45,9 +117,12 @@ class StackAllocator {
     return *this;
   }
 
-  StackAllocator(StackStorage<N>& storage): storage_(&storage) {}
+  template<size_t Align>
+  StackAllocator(StackStorage<N, Align>& storage): storage_(&storage) {}
+
+  StackAllocator(HugePageStorage<N>& storage): storage_(&storage) {}
 
-  StackStorage<N>* get_storage() const {
+  ArenaStorage* get_storage() const {
     return storage_;
   }
 